@@ -0,0 +1,954 @@
+#include "libwfc.h"
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+
+// wfc_cancel() may come from another thread, which needs C11 atomics. A
+// C99 build falls back to sig_atomic_t, safe from signal handlers only.
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef atomic_int CancelFlag;
+#define CANCEL_SET(flag, value) atomic_store(&(flag), (value))
+#define CANCEL_GET(flag) atomic_load(&(flag))
+#else
+typedef volatile sig_atomic_t CancelFlag;
+#define CANCEL_SET(flag, value) ((flag) = (value))
+#define CANCEL_GET(flag) (flag)
+#endif
+
+#define PATTERN_SIZE 3
+#define MAX_PATTERNS 255
+
+typedef struct {
+    WFCColor pixels[PATTERN_SIZE][PATTERN_SIZE];
+    int frequency;
+    int index;
+} Pattern;
+
+typedef struct {
+    bool possible[MAX_PATTERNS];
+    int num_possible;
+    bool collapsed;
+    int final_pattern;
+} Cell;
+
+// Downsampled copy of the problem, solved first in hierarchical mode
+typedef struct {
+    Pattern patterns[MAX_PATTERNS];
+    int pattern_count;
+    bool adjacency[MAX_PATTERNS][MAX_PATTERNS][4];
+    Cell *grid;             // width * height
+    int width;
+    int height;
+    bool ready;             // patterns and adjacency built from the downscaled input
+    bool solved;            // every coarse cell collapsed without contradiction
+    bool attempt_active;    // grid reset for the current attempt
+    int attempts;
+    int collapsed;          // cells collapsed in the current attempt
+    int seed_index;         // next coarse cell to seed the full grid from
+    bool truncated;         // pattern list filled up, later windows were dropped
+} CoarseLevel;
+
+// Cells changed since the last commit, so a failed seed can be rolled back
+typedef struct {
+    Cell *cells;            // saved copies, in order of first change
+    int *indices;           // grid index of each saved copy
+    bool *saved;            // width * height, set once a cell has a copy
+    int count;
+} UndoLog;
+
+struct WFC {
+    Pattern patterns[MAX_PATTERNS];
+    int pattern_count;
+    bool adjacency[MAX_PATTERNS][MAX_PATTERNS][4]; // [pattern1][pattern2][direction]
+    Cell *grid;             // width * height, row major
+    bool *changed;          // propagation scratch, width * height
+    int width;
+    int height;
+    WFCColor *input_pixels;
+    int input_width;
+    int input_height;
+    WFCPhase phase;
+    int generation_step;
+    bool contradiction;     // a cell ran out of patterns during collapse
+    unsigned int rng;
+    CancelFlag cancelled;
+    // Progress tracking
+    bool extraction_coarse; // sampling the coarse level's offsets
+    int extraction_offset;
+    int extraction_x;
+    int extraction_y;
+    int extraction_total;
+    int extraction_progress;
+    bool adjacency_coarse;
+    int adjacency_i;
+    int adjacency_j;
+    int adjacency_d;
+    int adjacency_total;
+    int adjacency_progress;
+    int grid_init_total;
+    int grid_init_progress;
+    // Coarse-to-fine solving
+    bool hierarchical;
+    int coarse_factor;
+    int coarse_max_attempts;
+    int coarse_seeded;
+    int coarse_skipped;
+    CoarseLevel *coarse;    // NULL when created with coarse_factor == 0
+    UndoLog undo;           // only allocated along with coarse
+};
+
+// Direction helpers: 0=up, 1=right, 2=down, 3=left
+static const int dx[] = {0, 1, 0, -1};
+static const int dy[] = {-1, 0, 1, 0};
+
+static size_t align_size(size_t size) {
+    return (size + WFC_ARENA_ALIGN - 1) & ~(size_t)(WFC_ARENA_ALIGN - 1);
+}
+
+void wfc_arena_init(WFCArena *arena, void *buffer, size_t size) {
+    arena->base = buffer;
+    arena->size = buffer ? size : 0;
+    arena->used = 0;
+}
+
+// Every block is padded to WFC_ARENA_ALIGN, so blocks stay aligned as
+// long as the buffer is
+static void *arena_alloc(WFCArena *arena, size_t size) {
+    size = align_size(size);
+    if(arena->used > arena->size || size > arena->size - arena->used) return NULL;
+    void *block = arena->base + arena->used;
+    arena->used += size;
+    return block;
+}
+
+// xorshift32, so solvers don't share rand() state
+static unsigned int next_random(WFC *wfc) {
+    unsigned int x = wfc->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    wfc->rng = x;
+    return x;
+}
+
+static bool colors_equal(WFCColor a, WFCColor b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+// Check if two patterns can be adjacent in given direction
+static bool patterns_compatible(Pattern *p1, Pattern *p2, int direction) {
+    int overlap = PATTERN_SIZE - 1;
+
+    switch(direction) {
+        case 0: // p2 is above p1
+            for(int x = 0; x < PATTERN_SIZE; x++) {
+                for(int y = 0; y < overlap; y++) {
+                    if(!colors_equal(p1->pixels[y][x], p2->pixels[y+1][x])) return false;
+                }
+            }
+            break;
+        case 1: // p2 is to the right of p1
+            for(int y = 0; y < PATTERN_SIZE; y++) {
+                for(int x = 0; x < overlap; x++) {
+                    if(!colors_equal(p1->pixels[y][x+1], p2->pixels[y][x])) return false;
+                }
+            }
+            break;
+        case 2: // p2 is below p1
+            for(int x = 0; x < PATTERN_SIZE; x++) {
+                for(int y = 0; y < overlap; y++) {
+                    if(!colors_equal(p1->pixels[y+1][x], p2->pixels[y][x])) return false;
+                }
+            }
+            break;
+        case 3: // p2 is to the left of p1
+            for(int y = 0; y < PATTERN_SIZE; y++) {
+                for(int x = 0; x < overlap; x++) {
+                    if(!colors_equal(p1->pixels[y][x], p2->pixels[y][x+1])) return false;
+                }
+            }
+            break;
+    }
+    return true;
+}
+
+// Check if pattern already exists in a pattern list
+static int find_pattern(Pattern *patterns, int pattern_count, Pattern *p) {
+    for(int i = 0; i < pattern_count; i++) {
+        bool match = true;
+        for(int y = 0; y < PATTERN_SIZE && match; y++) {
+            for(int x = 0; x < PATTERN_SIZE && match; x++) {
+                if(!colors_equal(patterns[i].pixels[y][x], p->pixels[y][x])) {
+                    match = false;
+                }
+            }
+        }
+        if(match) return i;
+    }
+    return -1;
+}
+
+// Add the pattern at (x, y) of an image sampled every `stride` pixels from
+// (ox, oy) to a pattern list, or bump its frequency. Returns false if the
+// list is full and the window was dropped.
+static bool add_pattern(Pattern *patterns, int *pattern_count, WFCColor *pixels, int width,
+                        int ox, int oy, int stride, int x, int y) {
+    Pattern p;
+    p.frequency = 1;
+
+    // Copy pattern pixels
+    for(int py = 0; py < PATTERN_SIZE; py++) {
+        for(int px = 0; px < PATTERN_SIZE; px++) {
+            p.pixels[py][px] = pixels[(oy + (y + py) * stride) * width + (ox + (x + px) * stride)];
+        }
+    }
+
+    // Check if pattern already exists
+    int existing = find_pattern(patterns, *pattern_count, &p);
+    if(existing >= 0) {
+        patterns[existing].frequency++;
+    } else if(*pattern_count < MAX_PATTERNS) {
+        p.index = *pattern_count;
+        patterns[*pattern_count] = p;
+        (*pattern_count)++;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Number of samples at offset, offset + stride, ... that fit in size
+static int sampled_size(int size, int offset, int stride) {
+    return (size - offset + stride - 1) / stride;
+}
+
+// Number of pattern windows in the input sampled every `stride` pixels from (ox, oy)
+static int window_count(WFC *wfc, int ox, int oy, int stride) {
+    int sw = sampled_size(wfc->input_width, ox, stride);
+    int sh = sampled_size(wfc->input_height, oy, stride);
+    if(sw < PATTERN_SIZE || sh < PATTERN_SIZE) return 0;
+    return (sw - PATTERN_SIZE + 1) * (sh - PATTERN_SIZE + 1);
+}
+
+// Initialize pattern extraction. Full size patterns come first, then coarse
+// ones from every sampling offset of the downscale, since the full size output
+// reuses input windows at any offset, not just multiples of the factor.
+static void start_extraction(WFC *wfc) {
+    wfc->phase = WFC_PHASE_EXTRACT;
+    wfc->pattern_count = 0;
+    wfc->extraction_coarse = false;
+    wfc->extraction_offset = 0;
+    wfc->extraction_x = 0;
+    wfc->extraction_y = 0;
+    wfc->extraction_total = window_count(wfc, 0, 0, 1);
+    wfc->extraction_progress = 0;
+    wfc->generation_step = 0;
+    wfc->contradiction = false;
+    if(wfc->coarse) {
+        int factor = wfc->coarse_factor;
+        for(int offset = 0; offset < factor * factor; offset++) {
+            wfc->extraction_total += window_count(wfc, offset % factor, offset / factor, factor);
+        }
+        wfc->coarse->pattern_count = 0;
+        wfc->coarse->truncated = false;
+        wfc->coarse->ready = false;
+        wfc->coarse->solved = false;
+    }
+}
+
+// Move extraction to the next sampling of the input. Returns false when done.
+static bool next_extraction_source(WFC *wfc) {
+    wfc->extraction_x = 0;
+    wfc->extraction_y = 0;
+    if(!wfc->extraction_coarse) {
+        if(wfc->coarse == NULL) return false;
+        wfc->extraction_coarse = true;
+        wfc->extraction_offset = 0;
+        return true;
+    }
+    wfc->extraction_offset++;
+    return wfc->extraction_offset < wfc->coarse_factor * wfc->coarse_factor;
+}
+
+// Process pattern extraction step by step
+static void extract_patterns_step(WFC *wfc, int steps) {
+    for(int step = 0; step < steps && !CANCEL_GET(wfc->cancelled); step++) {
+        int stride = wfc->extraction_coarse ? wfc->coarse_factor : 1;
+        int ox = wfc->extraction_offset % stride;
+        int oy = wfc->extraction_offset / stride;
+        int sw = sampled_size(wfc->input_width, ox, stride);
+        int sh = sampled_size(wfc->input_height, oy, stride);
+
+        if(sw < PATTERN_SIZE || wfc->extraction_y > sh - PATTERN_SIZE) {
+            if(next_extraction_source(wfc)) continue;
+
+            // Extraction complete, initialize adjacency building
+            wfc->phase = WFC_PHASE_ADJACENCY;
+            wfc->adjacency_coarse = false;
+            wfc->adjacency_i = 0;
+            wfc->adjacency_j = 0;
+            wfc->adjacency_d = 0;
+            wfc->adjacency_total = wfc->pattern_count * wfc->pattern_count * 4;
+            if(wfc->coarse) {
+                wfc->adjacency_total += wfc->coarse->pattern_count * wfc->coarse->pattern_count * 4;
+            }
+            wfc->adjacency_progress = 0;
+            return;
+        }
+
+        if(wfc->extraction_coarse) {
+            // Offsets share one list, so a full list drops the later ones
+            if(!add_pattern(wfc->coarse->patterns, &wfc->coarse->pattern_count, wfc->input_pixels,
+                            wfc->input_width, ox, oy, stride, wfc->extraction_x, wfc->extraction_y)) {
+                wfc->coarse->truncated = true;
+            }
+        } else {
+            add_pattern(wfc->patterns, &wfc->pattern_count, wfc->input_pixels, wfc->input_width,
+                        0, 0, 1, wfc->extraction_x, wfc->extraction_y);
+        }
+        wfc->extraction_progress++;
+
+        // Move to next position
+        wfc->extraction_x++;
+        if(wfc->extraction_x > sw - PATTERN_SIZE) {
+            wfc->extraction_x = 0;
+            wfc->extraction_y++;
+        }
+    }
+}
+
+// Calculate entropy (number of possible patterns) for a cell
+static int calculate_entropy(Cell *cell) {
+    if(cell->collapsed) return 1000000;
+    return cell->num_possible;
+}
+
+// Reset cells to full superposition
+static void reset_cells(Cell *cells, int count, int pattern_count) {
+    for(int i = 0; i < count; i++) {
+        cells[i].collapsed = false;
+        cells[i].num_possible = pattern_count;
+        cells[i].final_pattern = -1;
+        for(int p = 0; p < pattern_count; p++) {
+            cells[i].possible[p] = true;
+        }
+    }
+}
+
+// Find the cell with minimum entropy in a width x height grid
+static bool find_min_entropy_cell(WFC *wfc, Cell *grid, int width, int height, int *min_x, int *min_y) {
+    int min_entropy = 1000000;
+    bool found = false;
+
+    // Add some randomness to tie-breaking
+    int start_x = next_random(wfc) % width;
+    int start_y = next_random(wfc) % height;
+
+    for(int i = 0; i < height; i++) {
+        int y = (start_y + i) % height;
+        for(int j = 0; j < width; j++) {
+            int x = (start_x + j) % width;
+            if(!grid[y * width + x].collapsed) {
+                int entropy = calculate_entropy(&grid[y * width + x]);
+                if(entropy > 0 && entropy < min_entropy) {
+                    min_entropy = entropy;
+                    *min_x = x;
+                    *min_y = y;
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+// Collapse a cell to one of its possible patterns, weighted by frequency
+static void collapse_cell(WFC *wfc, Cell *cell, Pattern *patterns, int pattern_count) {
+    if(cell->collapsed || cell->num_possible == 0) return;
+
+    // Build weighted list of possible patterns
+    int total_weight = 0;
+    int weights[MAX_PATTERNS];
+    int valid_patterns[MAX_PATTERNS];
+    int valid_count = 0;
+
+    for(int p = 0; p < pattern_count; p++) {
+        if(cell->possible[p]) {
+            valid_patterns[valid_count] = p;
+            weights[valid_count] = patterns[p].frequency;
+            total_weight += weights[valid_count];
+            valid_count++;
+        }
+    }
+
+    if(valid_count == 0) return;
+
+    // Choose random pattern weighted by frequency
+    int r = next_random(wfc) % total_weight;
+    int chosen = 0;
+    for(int i = 0; i < valid_count; i++) {
+        r -= weights[i];
+        if(r < 0) {
+            chosen = valid_patterns[i];
+            break;
+        }
+    }
+
+    // Collapse to chosen pattern
+    for(int p = 0; p < pattern_count; p++) {
+        cell->possible[p] = (p == chosen);
+    }
+    cell->num_possible = 1;
+    cell->collapsed = true;
+    cell->final_pattern = chosen;
+}
+
+// Save a cell before its first change since the last commit
+static void undo_save(UndoLog *undo, Cell *grid, int index) {
+    if(undo == NULL || undo->saved[index]) return;
+    undo->saved[index] = true;
+    undo->cells[undo->count] = grid[index];
+    undo->indices[undo->count] = index;
+    undo->count++;
+}
+
+// Keep every change since the last commit
+static void undo_commit(UndoLog *undo) {
+    for(int i = 0; i < undo->count; i++) {
+        undo->saved[undo->indices[i]] = false;
+    }
+    undo->count = 0;
+}
+
+// Put every cell changed since the last commit back
+static void undo_rollback(UndoLog *undo, Cell *grid) {
+    for(int i = 0; i < undo->count; i++) {
+        grid[undo->indices[i]] = undo->cells[i];
+        undo->saved[undo->indices[i]] = false;
+    }
+    undo->count = 0;
+}
+
+// Propagate constraints outward from every cell marked in changed
+// (width x height). Returns false on contradiction, leaving changed dirty.
+// Cells are saved to undo first when one is given.
+static bool propagate_changes(Cell *grid, int width, int height, int pattern_count,
+                              bool (*adjacency)[MAX_PATTERNS][4], bool *changed,
+                              UndoLog *undo) {
+    bool any_changed = true;
+    while(any_changed) {
+        any_changed = false;
+
+        for(int cy = 0; cy < height; cy++) {
+            for(int cx = 0; cx < width; cx++) {
+                if(!changed[cy * width + cx]) continue;
+                changed[cy * width + cx] = false;
+                Cell *current = &grid[cy * width + cx];
+
+                // Check each neighbor
+                for(int d = 0; d < 4; d++) {
+                    int nx = cx + dx[d];
+                    int ny = cy + dy[d];
+
+                    if(nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+                    if(grid[ny * width + nx].collapsed) continue;
+
+                    Cell *neighbor = &grid[ny * width + nx];
+                    bool neighbor_changed = false;
+
+                    // Check which patterns are still valid for neighbor
+                    for(int np = 0; np < pattern_count; np++) {
+                        if(!neighbor->possible[np]) continue;
+
+                        bool valid = false;
+                        // Check if any pattern in current cell allows this neighbor pattern
+                        for(int cp = 0; cp < pattern_count; cp++) {
+                            if(current->possible[cp] && adjacency[cp][np][d]) {
+                                valid = true;
+                                break;
+                            }
+                        }
+
+                        if(!valid) {
+                            undo_save(undo, grid, ny * width + nx);
+                            neighbor->possible[np] = false;
+                            neighbor->num_possible--;
+                            neighbor_changed = true;
+                        }
+                    }
+
+                    if(neighbor->num_possible == 0) return false;
+                    if(neighbor_changed) {
+                        changed[ny * width + nx] = true;
+                        any_changed = true;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Advance the coarse solve by one collapse. Restarts are cheap at this
+// size, so a contradiction starts a new attempt, up to coarse_max_attempts.
+static void solve_coarse_step(WFC *wfc) {
+    CoarseLevel *coarse = wfc->coarse;
+    int count = coarse->width * coarse->height;
+
+    if(!coarse->attempt_active) {
+        if(coarse->attempts >= wfc->coarse_max_attempts) {
+            // Give up and solve without it
+            wfc->phase = WFC_PHASE_COLLAPSE;
+            return;
+        }
+        coarse->attempts++;
+        coarse->collapsed = 0;
+        coarse->attempt_active = true;
+        reset_cells(coarse->grid, count, coarse->pattern_count);
+        return;
+    }
+
+    int x, y;
+    if(find_min_entropy_cell(wfc, coarse->grid, coarse->width, coarse->height, &x, &y)) {
+        collapse_cell(wfc, &coarse->grid[y * coarse->width + x],
+                      coarse->patterns, coarse->pattern_count);
+        coarse->collapsed++;
+        memset(wfc->changed, 0, count * sizeof(bool));
+        wfc->changed[y * coarse->width + x] = true;
+        if(!propagate_changes(coarse->grid, coarse->width, coarse->height,
+                              coarse->pattern_count, coarse->adjacency,
+                              wfc->changed, NULL)) {
+            coarse->attempt_active = false;
+        }
+    } else {
+        coarse->solved = true;
+        coarse->attempt_active = false;
+        coarse->seed_index = 0;
+    }
+}
+
+// Restrict the anchor cell of one coarse block to patterns whose center
+// color matches the coarse solution and propagate. A seed that contradicts
+// the ones already applied is rolled back and skipped.
+static void apply_coarse_seed(WFC *wfc, int cx, int cy) {
+    CoarseLevel *coarse = wfc->coarse;
+    Pattern *cp = &coarse->patterns[coarse->grid[cy * coarse->width + cx].final_pattern];
+    WFCColor target = cp->pixels[PATTERN_SIZE/2][PATTERN_SIZE/2];
+    // The coarse center pixel sits at fine pixel factor * (cx + PATTERN_SIZE/2),
+    // which is the center of this fine cell
+    int fx = cx * wfc->coarse_factor + (wfc->coarse_factor - 1) * (PATTERN_SIZE/2);
+    int fy = cy * wfc->coarse_factor + (wfc->coarse_factor - 1) * (PATTERN_SIZE/2);
+    if(fx >= wfc->width || fy >= wfc->height) return;
+    int index = fy * wfc->width + fx;
+    Cell *cell = &wfc->grid[index];
+
+    // Skip blocks with no matching fine pattern rather than emptying them
+    int matches = 0;
+    for(int p = 0; p < wfc->pattern_count; p++) {
+        if(cell->possible[p] &&
+           colors_equal(wfc->patterns[p].pixels[PATTERN_SIZE/2][PATTERN_SIZE/2], target)) {
+            matches++;
+        }
+    }
+    if(matches == 0 || matches == cell->num_possible) return;
+
+    undo_save(&wfc->undo, wfc->grid, index);
+    for(int p = 0; p < wfc->pattern_count; p++) {
+        if(!colors_equal(wfc->patterns[p].pixels[PATTERN_SIZE/2][PATTERN_SIZE/2], target)) {
+            cell->possible[p] = false;
+        }
+    }
+    cell->num_possible = matches;
+
+    memset(wfc->changed, 0, wfc->width * wfc->height * sizeof(bool));
+    wfc->changed[index] = true;
+    if(propagate_changes(wfc->grid, wfc->width, wfc->height, wfc->pattern_count,
+                         wfc->adjacency, wfc->changed, &wfc->undo)) {
+        undo_commit(&wfc->undo);
+        wfc->coarse_seeded++;
+    } else {
+        undo_rollback(&wfc->undo, wfc->grid);
+        wfc->coarse_skipped++;
+    }
+}
+
+// One unit of the coarse phase: a coarse collapse while solving, then one
+// seed of the full size grid per coarse cell
+static void coarse_step(WFC *wfc) {
+    CoarseLevel *coarse = wfc->coarse;
+    if(!coarse->solved) {
+        solve_coarse_step(wfc);
+        return;
+    }
+
+    if(coarse->seed_index >= coarse->width * coarse->height) {
+        wfc->phase = WFC_PHASE_COLLAPSE;
+        return;
+    }
+    apply_coarse_seed(wfc, coarse->seed_index % coarse->width, coarse->seed_index / coarse->width);
+    coarse->seed_index++;
+}
+
+// Start grid initialization
+static void start_grid_init(WFC *wfc) {
+    wfc->phase = WFC_PHASE_INIT_GRID;
+    wfc->grid_init_total = wfc->width * wfc->height;
+    wfc->grid_init_progress = 0;
+    wfc->generation_step = 0;
+    wfc->contradiction = false;
+    wfc->coarse_seeded = 0;
+    wfc->coarse_skipped = 0;
+    if(wfc->coarse) {
+        wfc->coarse->solved = false;
+        wfc->coarse->attempt_active = false;
+        wfc->coarse->attempts = 0;
+        wfc->coarse->collapsed = 0;
+        wfc->coarse->seed_index = 0;
+    }
+}
+
+// Pattern list and adjacency table of the level adjacency is being built for
+static int adjacency_level(WFC *wfc, Pattern **patterns, bool (**adjacency)[MAX_PATTERNS][4]) {
+    if(wfc->adjacency_coarse && wfc->coarse) {
+        *patterns = wfc->coarse->patterns;
+        *adjacency = wfc->coarse->adjacency;
+        return wfc->coarse->pattern_count;
+    }
+    *patterns = wfc->patterns;
+    *adjacency = wfc->adjacency;
+    return wfc->pattern_count;
+}
+
+// Build adjacency rules step by step, full size level first, then coarse
+static void build_adjacency_step(WFC *wfc, int steps) {
+    for(int step = 0; step < steps && !CANCEL_GET(wfc->cancelled); step++) {
+        Pattern *patterns;
+        bool (*adjacency)[MAX_PATTERNS][4];
+        int pattern_count = adjacency_level(wfc, &patterns, &adjacency);
+
+        if(wfc->adjacency_i >= pattern_count) {
+            if(!wfc->adjacency_coarse && wfc->coarse) {
+                wfc->adjacency_coarse = true;
+                wfc->adjacency_i = 0;
+                wfc->adjacency_j = 0;
+                wfc->adjacency_d = 0;
+                continue;
+            }
+
+            // Adjacency building complete
+            if(wfc->coarse) {
+                wfc->coarse->ready = wfc->coarse->pattern_count > 0;
+            }
+            start_grid_init(wfc);
+            return;
+        }
+
+        bool compatible = patterns_compatible(&patterns[wfc->adjacency_i],
+                                              &patterns[wfc->adjacency_j],
+                                              wfc->adjacency_d);
+        adjacency[wfc->adjacency_i][wfc->adjacency_j][wfc->adjacency_d] = compatible;
+        wfc->adjacency_progress++;
+
+        // Move to next adjacency
+        wfc->adjacency_d++;
+        if(wfc->adjacency_d >= 4) {
+            wfc->adjacency_d = 0;
+            wfc->adjacency_j++;
+            if(wfc->adjacency_j >= pattern_count) {
+                wfc->adjacency_j = 0;
+                wfc->adjacency_i++;
+            }
+        }
+    }
+}
+
+// Process grid initialization step by step
+static void init_grid_step(WFC *wfc, int cells) {
+    for(int step = 0; step < cells && !CANCEL_GET(wfc->cancelled); step++) {
+        if(wfc->grid_init_progress >= wfc->grid_init_total) {
+            // Grid initialization complete, solve the coarse level next if enabled
+            if(wfc->coarse && wfc->hierarchical && wfc->coarse->ready) {
+                wfc->phase = WFC_PHASE_COARSE;
+            } else {
+                wfc->phase = WFC_PHASE_COLLAPSE;
+            }
+            return;
+        }
+
+        reset_cells(&wfc->grid[wfc->grid_init_progress], 1, wfc->pattern_count);
+        wfc->grid_init_progress++;
+    }
+}
+
+// Perform one collapse and its propagation. Stops the run as soon as a
+// cell runs out of patterns instead of collapsing around the hole.
+static void collapse_step(WFC *wfc) {
+    int x, y;
+    if(find_min_entropy_cell(wfc, wfc->grid, wfc->width, wfc->height, &x, &y)) {
+        collapse_cell(wfc, &wfc->grid[y * wfc->width + x], wfc->patterns, wfc->pattern_count);
+        memset(wfc->changed, 0, wfc->width * wfc->height * sizeof(bool));
+        wfc->changed[y * wfc->width + x] = true;
+        wfc->generation_step++;
+        if(!propagate_changes(wfc->grid, wfc->width, wfc->height,
+                              wfc->pattern_count, wfc->adjacency, wfc->changed, NULL)) {
+            wfc->contradiction = true;
+            wfc->phase = WFC_PHASE_DONE;
+        }
+    } else {
+        wfc->phase = WFC_PHASE_DONE;
+    }
+}
+
+static bool coarse_enabled(const WFCConfig *config) {
+    return config->coarse_factor > 0 &&
+           config->output_width / config->coarse_factor > 0 &&
+           config->output_height / config->coarse_factor > 0;
+}
+
+size_t wfc_arena_size(const WFCConfig *config, int input_width, int input_height) {
+    if(input_width <= 0 || input_height <= 0 ||
+       config->output_width <= 0 || config->output_height <= 0) return 0;
+
+    size_t cells = (size_t)config->output_width * config->output_height;
+    size_t size = align_size(sizeof(WFC));
+    size += align_size((size_t)input_width * input_height * sizeof(WFCColor));
+    size += align_size(cells * sizeof(Cell));
+    size += align_size(cells * sizeof(bool));
+    if(coarse_enabled(config)) {
+        size_t coarse_cells = (size_t)(config->output_width / config->coarse_factor) *
+                              (config->output_height / config->coarse_factor);
+        size += align_size(sizeof(CoarseLevel));
+        size += align_size(coarse_cells * sizeof(Cell));
+        size += align_size(cells * sizeof(Cell));
+        size += align_size(cells * sizeof(int));
+        size += align_size(cells * sizeof(bool));
+    }
+    return size;
+}
+
+WFC *wfc_create(WFCArena *arena, const WFCConfig *config,
+                const unsigned char *rgba, int input_width, int input_height) {
+    if(rgba == NULL || input_width < PATTERN_SIZE || input_height < PATTERN_SIZE ||
+       config->output_width <= 0 || config->output_height <= 0) return NULL;
+
+    if((uintptr_t)arena->base % WFC_ARENA_ALIGN != 0 || arena->used % WFC_ARENA_ALIGN != 0) return NULL;
+
+    size_t mark = arena->used;
+    size_t cells = (size_t)config->output_width * config->output_height;
+    size_t pixels = (size_t)input_width * input_height;
+
+    WFC *wfc = arena_alloc(arena, sizeof(WFC));
+    if(wfc == NULL) goto fail;
+    memset(wfc, 0, sizeof(WFC));
+    CANCEL_SET(wfc->cancelled, 0);
+    wfc->input_pixels = arena_alloc(arena, pixels * sizeof(WFCColor));
+    wfc->grid = arena_alloc(arena, cells * sizeof(Cell));
+    wfc->changed = arena_alloc(arena, cells * sizeof(bool));
+    if(wfc->input_pixels == NULL || wfc->grid == NULL || wfc->changed == NULL) goto fail;
+
+    memcpy(wfc->input_pixels, rgba, pixels * sizeof(WFCColor));
+    wfc->input_width = input_width;
+    wfc->input_height = input_height;
+    wfc->width = config->output_width;
+    wfc->height = config->output_height;
+    wfc->rng = config->seed ? config->seed : 2463534242u;
+    wfc->coarse_max_attempts = config->coarse_max_attempts;
+
+    if(coarse_enabled(config)) {
+        int factor = config->coarse_factor;
+        CoarseLevel *coarse = arena_alloc(arena, sizeof(CoarseLevel));
+        if(coarse == NULL) goto fail;
+        memset(coarse, 0, sizeof(CoarseLevel));
+        coarse->width = wfc->width / factor;
+        coarse->height = wfc->height / factor;
+        coarse->grid = arena_alloc(arena, (size_t)coarse->width * coarse->height * sizeof(Cell));
+        wfc->undo.cells = arena_alloc(arena, cells * sizeof(Cell));
+        wfc->undo.indices = arena_alloc(arena, cells * sizeof(int));
+        wfc->undo.saved = arena_alloc(arena, cells * sizeof(bool));
+        if(coarse->grid == NULL || wfc->undo.cells == NULL ||
+           wfc->undo.indices == NULL || wfc->undo.saved == NULL) goto fail;
+        memset(wfc->undo.saved, 0, cells * sizeof(bool));
+
+        wfc->coarse = coarse;
+        wfc->coarse_factor = factor;
+        wfc->hierarchical = config->hierarchical;
+    }
+
+    start_extraction(wfc);
+    return wfc;
+
+fail:
+    arena->used = mark;
+    return NULL;
+}
+
+WFCStatus wfc_step(WFC *wfc, int steps) {
+    if(CANCEL_GET(wfc->cancelled)) return WFC_CANCELLED;
+
+    switch(wfc->phase) {
+        case WFC_PHASE_EXTRACT:
+            extract_patterns_step(wfc, steps);
+            break;
+        case WFC_PHASE_ADJACENCY:
+            build_adjacency_step(wfc, steps);
+            break;
+        case WFC_PHASE_INIT_GRID:
+            init_grid_step(wfc, steps);
+            break;
+        case WFC_PHASE_COARSE:
+            for(int i = 0; i < steps && wfc->phase == WFC_PHASE_COARSE && !CANCEL_GET(wfc->cancelled); i++) {
+                coarse_step(wfc);
+            }
+            break;
+        case WFC_PHASE_COLLAPSE:
+            for(int i = 0; i < steps && wfc->phase == WFC_PHASE_COLLAPSE && !CANCEL_GET(wfc->cancelled); i++) {
+                collapse_step(wfc);
+            }
+            break;
+        case WFC_PHASE_DONE:
+            break;
+    }
+
+    if(CANCEL_GET(wfc->cancelled)) return WFC_CANCELLED;
+    if(wfc->phase != WFC_PHASE_DONE) return WFC_RUNNING;
+    return wfc->contradiction ? WFC_CONTRADICTION : WFC_DONE;
+}
+
+WFCStatus wfc_run(WFC *wfc) {
+    WFCStatus status;
+    do {
+        status = wfc_step(wfc, 64);
+    } while(status == WFC_RUNNING);
+    return status;
+}
+
+void wfc_cancel(WFC *wfc) {
+    CANCEL_SET(wfc->cancelled, 1);
+}
+
+void wfc_reset(WFC *wfc) {
+    CANCEL_SET(wfc->cancelled, 0);
+    if(wfc->phase >= WFC_PHASE_INIT_GRID) {
+        start_grid_init(wfc);
+    }
+}
+
+void wfc_restart(WFC *wfc) {
+    CANCEL_SET(wfc->cancelled, 0);
+    start_extraction(wfc);
+}
+
+bool wfc_set_hierarchical(WFC *wfc, bool enabled) {
+    if(wfc->coarse == NULL) return false;
+    wfc->hierarchical = enabled;
+    return true;
+}
+
+bool wfc_hierarchical(const WFC *wfc) {
+    return wfc->hierarchical;
+}
+
+WFCPhase wfc_phase(const WFC *wfc) {
+    return wfc->phase;
+}
+
+void wfc_phase_progress(const WFC *wfc, int *done, int *total) {
+    switch(wfc->phase) {
+        case WFC_PHASE_EXTRACT:
+            *done = wfc->extraction_progress;
+            *total = wfc->extraction_total;
+            break;
+        case WFC_PHASE_ADJACENCY:
+            *done = wfc->adjacency_progress;
+            *total = wfc->adjacency_total;
+            break;
+        case WFC_PHASE_INIT_GRID:
+            *done = wfc->grid_init_progress;
+            *total = wfc->grid_init_total;
+            break;
+        case WFC_PHASE_COARSE: {
+            // First half solving, second half seeding
+            int coarse_cells = wfc->coarse->width * wfc->coarse->height;
+            *done = wfc->coarse->solved ? coarse_cells + wfc->coarse->seed_index : wfc->coarse->collapsed;
+            *total = 2 * coarse_cells;
+            break;
+        }
+        default:
+            *done = wfc->generation_step;
+            *total = wfc->width * wfc->height;
+            break;
+    }
+}
+
+int wfc_pattern_count(const WFC *wfc) {
+    return wfc->pattern_count;
+}
+
+int wfc_generation_step(const WFC *wfc) {
+    return wfc->generation_step;
+}
+
+bool wfc_contradiction(const WFC *wfc) {
+    return wfc->contradiction;
+}
+
+int wfc_output_width(const WFC *wfc) {
+    return wfc->width;
+}
+
+int wfc_output_height(const WFC *wfc) {
+    return wfc->height;
+}
+
+int wfc_coarse_pattern_count(const WFC *wfc) {
+    return wfc->coarse ? wfc->coarse->pattern_count : 0;
+}
+
+bool wfc_coarse_truncated(const WFC *wfc) {
+    return wfc->coarse ? wfc->coarse->truncated : false;
+}
+
+bool wfc_coarse_solved(const WFC *wfc) {
+    return wfc->coarse ? wfc->coarse->solved : false;
+}
+
+int wfc_coarse_attempts(const WFC *wfc) {
+    return wfc->coarse ? wfc->coarse->attempts : 0;
+}
+
+int wfc_coarse_seeded(const WFC *wfc) {
+    return wfc->coarse_seeded;
+}
+
+int wfc_coarse_skipped(const WFC *wfc) {
+    return wfc->coarse_skipped;
+}
+
+static bool in_grid(const WFC *wfc, int x, int y) {
+    return x >= 0 && x < wfc->width && y >= 0 && y < wfc->height;
+}
+
+int wfc_cell_possible(const WFC *wfc, int x, int y) {
+    if(!in_grid(wfc, x, y)) return 0;
+    if(wfc->phase < WFC_PHASE_COARSE) return wfc->pattern_count;
+    return wfc->grid[y * wfc->width + x].num_possible;
+}
+
+bool wfc_cell_color(const WFC *wfc, int x, int y, WFCColor *color) {
+    if(!in_grid(wfc, x, y) || wfc->phase < WFC_PHASE_COARSE) return false;
+    const Cell *cell = &wfc->grid[y * wfc->width + x];
+    if(!cell->collapsed || cell->final_pattern < 0) return false;
+    *color = wfc->patterns[cell->final_pattern].pixels[PATTERN_SIZE/2][PATTERN_SIZE/2];
+    return true;
+}
+
+void wfc_write_rgba(const WFC *wfc, unsigned char *rgba) {
+    for(int y = 0; y < wfc->height; y++) {
+        for(int x = 0; x < wfc->width; x++) {
+            WFCColor color = {0, 0, 0, 0};
+            wfc_cell_color(wfc, x, y, &color);
+            memcpy(&rgba[(y * wfc->width + x) * 4], &color, 4);
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef LIBWFC_H
+#define LIBWFC_H
+
+// Renderer-free Wave Function Collapse solver.
+//
+// Input is a raw RGBA8 buffer, output is read back per cell or as an RGBA8
+// buffer. All memory comes from a caller-supplied arena: size it with
+// wfc_arena_size(), hand it to wfc_create(), and free it yourself when done.
+// The library never calls malloc and never prints.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    unsigned char r, g, b, a;
+} WFCColor;
+
+// Arena buffers must be aligned to this, as malloc() returns on common platforms
+#define WFC_ARENA_ALIGN 16
+
+// Bump allocator over a caller-owned buffer
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+} WFCArena;
+
+typedef struct {
+    int output_width;
+    int output_height;
+    unsigned int seed;          // 0 picks a fixed default
+    int coarse_factor;          // downscale for hierarchical mode, 0 = not supported
+    int coarse_max_attempts;    // coarse retries before solving without it
+    bool hierarchical;          // start with coarse-to-fine solving enabled
+} WFCConfig;
+
+typedef enum {
+    WFC_PHASE_EXTRACT,          // extracting patterns from the input
+    WFC_PHASE_ADJACENCY,        // building adjacency rules
+    WFC_PHASE_INIT_GRID,        // putting cells into superposition
+    WFC_PHASE_COARSE,           // hierarchical mode: solving the coarse grid, then seeding from it
+    WFC_PHASE_COLLAPSE,         // collapsing and propagating
+    WFC_PHASE_DONE              // finished, or stopped on a contradiction
+} WFCPhase;
+
+typedef enum {
+    WFC_RUNNING,                // more work left
+    WFC_DONE,                   // every cell collapsed, output is complete
+    WFC_CONTRADICTION,          // a cell ran out of patterns, output has holes;
+                                // wfc_reset() and run again
+    WFC_CANCELLED               // wfc_cancel() was called
+} WFCStatus;
+
+// Opaque solver state, lives inside the arena
+typedef struct WFC WFC;
+
+void wfc_arena_init(WFCArena *arena, void *buffer, size_t size);
+
+// Exact bytes wfc_create() will take from the arena for this config and input
+size_t wfc_arena_size(const WFCConfig *config, int input_width, int input_height);
+
+// Copies the input into the arena. Returns NULL if the arena is too small or
+// misaligned, or the input is smaller than a pattern.
+WFC *wfc_create(WFCArena *arena, const WFCConfig *config,
+                const unsigned char *rgba, int input_width, int input_height);
+
+// Advance the current phase by up to `steps` units: one pattern window,
+// adjacency rule, cell, coarse collapse, seed or collapse each. Collapses and
+// seeds include their propagation, which can reach the whole grid. Stops at
+// phase boundaries so callers can pick per-phase budgets.
+WFCStatus wfc_step(WFC *wfc, int steps);
+
+// Run every remaining phase to completion, checking for cancellation.
+// Only WFC_DONE means the output is complete.
+WFCStatus wfc_run(WFC *wfc);
+
+// Ask wfc_step()/wfc_run() to stop. Checked between units of work, so a
+// collapse or seed already propagating finishes first. Safe from a signal
+// handler; safe from another thread only when libwfc is built as C11 with
+// atomics (the Makefile does). Sticks until wfc_reset() or wfc_restart().
+void wfc_cancel(WFC *wfc);
+
+// Restart the grid, keeping extracted patterns and adjacency rules
+void wfc_reset(WFC *wfc);
+
+// Restart from pattern extraction
+void wfc_restart(WFC *wfc);
+
+// Returns false if the solver was created without coarse storage
+bool wfc_set_hierarchical(WFC *wfc, bool enabled);
+bool wfc_hierarchical(const WFC *wfc);
+
+WFCPhase wfc_phase(const WFC *wfc);
+void wfc_phase_progress(const WFC *wfc, int *done, int *total);
+int wfc_pattern_count(const WFC *wfc);
+int wfc_generation_step(const WFC *wfc);
+
+// True once a run has stopped because a cell was left with no patterns
+bool wfc_contradiction(const WFC *wfc);
+int wfc_output_width(const WFC *wfc);
+int wfc_output_height(const WFC *wfc);
+
+// Coarse level state for the current run
+int wfc_coarse_pattern_count(const WFC *wfc);
+// True if the coarse pattern list filled up during extraction. Windows past
+// that point, mostly from later sampling offsets, add no patterns or weight.
+bool wfc_coarse_truncated(const WFC *wfc);
+bool wfc_coarse_solved(const WFC *wfc);
+int wfc_coarse_attempts(const WFC *wfc);
+int wfc_coarse_seeded(const WFC *wfc);   // cells pre-constrained
+int wfc_coarse_skipped(const WFC *wfc);  // seeds rolled back because they contradicted
+
+// Number of patterns still possible for a cell, 0 means contradiction.
+// Returns 0 for cells outside the output.
+int wfc_cell_possible(const WFC *wfc, int x, int y);
+
+// Center color of the cell's pattern. Returns false if not collapsed or
+// outside the output.
+bool wfc_cell_color(const WFC *wfc, int x, int y, WFCColor *color);
+
+// Write output_width * output_height RGBA8 pixels, uncollapsed cells are {0,0,0,0}
+void wfc_write_rgba(const WFC *wfc, unsigned char *rgba);
+
+#endif
@@ -0,0 +1,434 @@
+// Headless checks for libwfc: loads a seed PNG as raw RGBA and exercises the
+// arena, cancellation, determinism and contradiction handling.
+//
+// Built from the library source rather than libwfc.a, so the coarse seeding
+// checks can reach the solver internals.
+#define _POSIX_C_SOURCE 200809L
+#include "libwfc.c"
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <zlib.h>
+
+#define DEFAULT_SEED "seeds/brick.png"
+#define TEST_SIZE 24
+#define MAX_RETRIES 20
+#define CANCEL_SIZE 48          // big enough that one wfc_step() outlasts the timer
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while(0)
+
+static unsigned int read_be32(const unsigned char *p) {
+    return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+}
+
+static int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if(pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// Load an 8-bit, non-interlaced RGB or RGBA PNG as RGBA8. Returns NULL on
+// unsupported, truncated or corrupt files and on allocation failure.
+static unsigned char *load_png_rgba(const char *path, int *width, int *height) {
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *data = size > 0 ? malloc(size) : NULL;
+    if(data == NULL || fread(data, 1, size, file) != (size_t)size) {
+        fclose(file);
+        free(data);
+        return NULL;
+    }
+    fclose(file);
+
+    unsigned char *compressed = NULL, *raw = NULL, *pixels = NULL, *rgba = NULL;
+    if(size < 33 || memcmp(data, "\x89PNG\r\n\x1a\n", 8) != 0) goto fail;
+    unsigned int png_width = read_be32(data + 16);
+    unsigned int png_height = read_be32(data + 20);
+    int channels = data[25] == 6 ? 4 : data[25] == 2 ? 3 : 0;
+    if(data[24] != 8 || channels == 0 || data[28] != 0) goto fail;
+    if(png_width == 0 || png_height == 0 || png_width > 4096 || png_height > 4096) goto fail;
+
+    // Concatenate IDAT chunks, rejecting any that run past the end of the file
+    compressed = malloc(size);
+    if(compressed == NULL) goto fail;
+    size_t compressed_size = 0;
+    for(long pos = 8; pos + 12 <= size; ) {
+        unsigned long length = read_be32(data + pos);
+        if(length > (unsigned long)(size - pos - 12)) goto fail;
+        if(memcmp(data + pos + 4, "IDAT", 4) == 0) {
+            memcpy(compressed + compressed_size, data + pos + 8, length);
+            compressed_size += length;
+        }
+        pos += 12 + length;
+    }
+
+    size_t stride = (size_t)png_width * channels;
+    uLongf expected = (stride + 1) * png_height;
+    uLongf raw_size = expected;
+    raw = malloc(raw_size);
+    pixels = malloc(stride * png_height);
+    rgba = malloc((size_t)png_width * png_height * 4);
+    if(raw == NULL || pixels == NULL || rgba == NULL) goto fail;
+    if(uncompress(raw, &raw_size, compressed, compressed_size) != Z_OK || raw_size != expected) goto fail;
+
+    // Undo scanline filters
+    for(unsigned int y = 0; y < png_height; y++) {
+        unsigned char filter = raw[y * (stride + 1)];
+        unsigned char *src = raw + y * (stride + 1) + 1;
+        unsigned char *row = pixels + y * stride;
+        unsigned char *up = y > 0 ? row - stride : NULL;
+        if(filter > 4) goto fail;
+        for(size_t i = 0; i < stride; i++) {
+            int a = i >= (size_t)channels ? row[i - channels] : 0;
+            int b = up ? up[i] : 0;
+            int c = up && i >= (size_t)channels ? up[i - channels] : 0;
+            int value = src[i];
+            switch(filter) {
+                case 1: value += a; break;
+                case 2: value += b; break;
+                case 3: value += (a + b) / 2; break;
+                case 4: value += paeth(a, b, c); break;
+            }
+            row[i] = (unsigned char)value;
+        }
+    }
+
+    for(size_t i = 0; i < (size_t)png_width * png_height; i++) {
+        rgba[i * 4 + 0] = pixels[i * channels + 0];
+        rgba[i * 4 + 1] = pixels[i * channels + 1];
+        rgba[i * 4 + 2] = pixels[i * channels + 2];
+        rgba[i * 4 + 3] = channels == 4 ? pixels[i * channels + 3] : 255;
+    }
+    *width = (int)png_width;
+    *height = (int)png_height;
+
+    free(data);
+    free(compressed);
+    free(raw);
+    free(pixels);
+    return rgba;
+
+fail:
+    free(data);
+    free(compressed);
+    free(raw);
+    free(pixels);
+    free(rgba);
+    return NULL;
+}
+
+static WFCConfig test_config(bool hierarchical, unsigned int seed) {
+    WFCConfig config = {
+        .output_width = TEST_SIZE,
+        .output_height = TEST_SIZE,
+        .seed = seed,
+        .coarse_factor = 2,
+        .coarse_max_attempts = 8,
+        .hierarchical = hierarchical,
+    };
+    return config;
+}
+
+// wfc_arena_size() is exact: create succeeds with it and fails with a byte less
+static void test_arena_size(const unsigned char *rgba, int width, int height) {
+    for(int h = 0; h < 2; h++) {
+        WFCConfig config = test_config(h, 1);
+        size_t size = wfc_arena_size(&config, width, height);
+        void *buffer = malloc(size);
+        WFCArena arena;
+
+        wfc_arena_init(&arena, buffer, size);
+        CHECK(wfc_create(&arena, &config, rgba, width, height) != NULL);
+        CHECK(arena.used == size);
+
+        wfc_arena_init(&arena, buffer, size - 1);
+        CHECK(wfc_create(&arena, &config, rgba, width, height) == NULL);
+        CHECK(arena.used == 0);
+
+        // Misaligned buffers are rejected rather than overrun
+        wfc_arena_init(&arena, (unsigned char *)buffer + 1, size - 1);
+        CHECK(wfc_create(&arena, &config, rgba, width, height) == NULL);
+
+        free(buffer);
+    }
+}
+
+// Cancel sticks until reset, and a reset solver runs to an end state
+static void test_cancel_reset(const unsigned char *rgba, int width, int height) {
+    WFCConfig config = test_config(true, 2);
+    size_t size = wfc_arena_size(&config, width, height);
+    void *buffer = malloc(size);
+    WFCArena arena;
+    wfc_arena_init(&arena, buffer, size);
+    WFC *wfc = wfc_create(&arena, &config, rgba, width, height);
+    CHECK(wfc != NULL);
+    if(wfc == NULL) {
+        free(buffer);
+        return;
+    }
+
+    CHECK(wfc_step(wfc, 10) == WFC_RUNNING);
+    wfc_cancel(wfc);
+    CHECK(wfc_step(wfc, 10) == WFC_CANCELLED);
+    CHECK(wfc_run(wfc) == WFC_CANCELLED);
+
+    wfc_reset(wfc);
+    WFCStatus status = wfc_run(wfc);
+    CHECK(status == WFC_DONE || status == WFC_CONTRADICTION);
+
+    // Cancel mid-collapse, then reset keeps the patterns and starts over
+    wfc_reset(wfc);
+    while(wfc_phase(wfc) != WFC_PHASE_COLLAPSE && wfc_step(wfc, 1) == WFC_RUNNING);
+    wfc_step(wfc, 5);
+    wfc_cancel(wfc);
+    CHECK(wfc_run(wfc) == WFC_CANCELLED);
+    wfc_reset(wfc);
+    CHECK(wfc_phase(wfc) == WFC_PHASE_INIT_GRID);
+    CHECK(wfc_generation_step(wfc) == 0);
+    status = wfc_run(wfc);
+    CHECK(status == WFC_DONE || status == WFC_CONTRADICTION);
+
+    free(buffer);
+}
+
+static WFC *alarm_wfc;
+static volatile sig_atomic_t alarm_step = -1;
+
+static void cancel_on_alarm(int sig) {
+    (void)sig;
+    alarm_step = wfc_generation_step(alarm_wfc);
+    wfc_cancel(alarm_wfc);
+}
+
+// A cancel landing inside one long wfc_step() call stops it after at most
+// the unit in flight, instead of running out the requested steps
+static void test_cancel_latency(const unsigned char *rgba, int width, int height) {
+    WFCConfig config = test_config(false, 3);
+    config.output_width = CANCEL_SIZE;
+    config.output_height = CANCEL_SIZE;
+    size_t size = wfc_arena_size(&config, width, height);
+    void *buffer = malloc(size);
+    WFCArena arena;
+    wfc_arena_init(&arena, buffer, size);
+    WFC *wfc = wfc_create(&arena, &config, rgba, width, height);
+    CHECK(wfc != NULL);
+    if(wfc == NULL) {
+        free(buffer);
+        return;
+    }
+    while(wfc_phase(wfc) != WFC_PHASE_COLLAPSE && wfc_step(wfc, 100) == WFC_RUNNING);
+
+    // Cancelled before the call, nothing runs
+    wfc_cancel(wfc);
+    CHECK(wfc_step(wfc, INT_MAX) == WFC_CANCELLED);
+    CHECK(wfc_generation_step(wfc) == 0);
+    wfc_reset(wfc);
+    while(wfc_phase(wfc) != WFC_PHASE_COLLAPSE && wfc_step(wfc, 100) == WFC_RUNNING);
+
+    // Cancelled from a signal handler 1ms into the call
+    alarm_wfc = wfc;
+    alarm_step = -1;
+    signal(SIGALRM, cancel_on_alarm);
+    struct itimerval timer = {{0, 0}, {0, 1000}};
+    setitimer(ITIMER_REAL, &timer, NULL);
+    WFCStatus status = wfc_step(wfc, INT_MAX);
+    struct itimerval off = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_REAL, &off, NULL);
+    signal(SIGALRM, SIG_DFL);
+
+    CHECK(alarm_step >= 0);
+    CHECK(status == WFC_CANCELLED);
+    CHECK(wfc_phase(wfc) == WFC_PHASE_COLLAPSE);
+    CHECK(wfc_generation_step(wfc) <= alarm_step + 1);
+
+    free(buffer);
+}
+
+// Run with retries on contradiction, writing the output
+static WFCStatus solve(const unsigned char *rgba, int width, int height, bool hierarchical,
+                       unsigned int seed, unsigned char *output, bool check_cells) {
+    WFCConfig config = test_config(hierarchical, seed);
+    size_t size = wfc_arena_size(&config, width, height);
+    void *buffer = malloc(size);
+    WFCArena arena;
+    wfc_arena_init(&arena, buffer, size);
+    WFC *wfc = wfc_create(&arena, &config, rgba, width, height);
+    if(wfc == NULL) {
+        free(buffer);
+        return WFC_CANCELLED;
+    }
+
+    WFCStatus status = wfc_run(wfc);
+    for(int retry = 0; status == WFC_CONTRADICTION && retry < MAX_RETRIES; retry++) {
+        wfc_reset(wfc);
+        status = wfc_run(wfc);
+    }
+    wfc_write_rgba(wfc, output);
+
+    if(check_cells && status == WFC_DONE && hierarchical) {
+        // The coarse phase ran and actually constrained the full grid
+        CHECK(wfc_coarse_attempts(wfc) >= 1);
+        CHECK(wfc_coarse_solved(wfc));
+        CHECK(wfc_coarse_seeded(wfc) > 0);
+    }
+
+    if(check_cells && status == WFC_DONE) {
+        // A solved output has every cell down to exactly one pattern
+        int empty = 0;
+        for(int y = 0; y < TEST_SIZE; y++) {
+            for(int x = 0; x < TEST_SIZE; x++) {
+                WFCColor color;
+                if(wfc_cell_possible(wfc, x, y) != 1 || !wfc_cell_color(wfc, x, y, &color)) empty++;
+            }
+        }
+        CHECK(empty == 0);
+        CHECK(!wfc_contradiction(wfc));
+
+        // Out of range cells are rejected, not read
+        WFCColor color;
+        CHECK(wfc_cell_possible(wfc, -1, 0) == 0);
+        CHECK(wfc_cell_possible(wfc, TEST_SIZE, 0) == 0);
+        CHECK(!wfc_cell_color(wfc, 0, TEST_SIZE, &color));
+    }
+
+    free(buffer);
+    return status;
+}
+
+static bool cells_equal(const Cell *a, const Cell *b, int count, int pattern_count) {
+    for(int i = 0; i < count; i++) {
+        if(a[i].num_possible != b[i].num_possible || a[i].collapsed != b[i].collapsed ||
+           a[i].final_pattern != b[i].final_pattern ||
+           memcmp(a[i].possible, b[i].possible, pattern_count * sizeof(bool)) != 0) return false;
+    }
+    return true;
+}
+
+// A seed that contradicts is rolled back through the undo log, leaving the
+// grid exactly as it was; a seed that fits is kept
+static void test_seed_rollback(const unsigned char *rgba, int width, int height) {
+    WFCConfig config = test_config(true, 5);
+    size_t size = wfc_arena_size(&config, width, height);
+    void *buffer = malloc(size);
+    WFCArena arena;
+    wfc_arena_init(&arena, buffer, size);
+    WFC *wfc = wfc_create(&arena, &config, rgba, width, height);
+    CHECK(wfc != NULL);
+    if(wfc == NULL) {
+        free(buffer);
+        return;
+    }
+
+    // Solve the coarse grid, stopping before any seed is applied
+    while(wfc_phase(wfc) != WFC_PHASE_COARSE && wfc_step(wfc, 100) == WFC_RUNNING);
+    while(wfc_phase(wfc) == WFC_PHASE_COARSE && !wfc->coarse->solved) wfc_step(wfc, 1);
+    CHECK(wfc_coarse_solved(wfc));
+    if(!wfc_coarse_solved(wfc)) {
+        free(buffer);
+        return;
+    }
+
+    // Force a contradiction: patterns with the seed's center color allow no neighbors
+    CoarseLevel *coarse = wfc->coarse;
+    WFCColor target = coarse->patterns[coarse->grid[0].final_pattern].pixels[PATTERN_SIZE/2][PATTERN_SIZE/2];
+    size_t adjacency_size = sizeof(wfc->adjacency);
+    bool (*saved_adjacency)[MAX_PATTERNS][4] = malloc(adjacency_size);
+    memcpy(saved_adjacency, wfc->adjacency, adjacency_size);
+    for(int p = 0; p < wfc->pattern_count; p++) {
+        if(colors_equal(wfc->patterns[p].pixels[PATTERN_SIZE/2][PATTERN_SIZE/2], target)) {
+            memset(wfc->adjacency[p], 0, sizeof(wfc->adjacency[p]));
+        }
+    }
+
+    int cells = wfc->width * wfc->height;
+    Cell *before = malloc(cells * sizeof(Cell));
+    memcpy(before, wfc->grid, cells * sizeof(Cell));
+    int seeded = wfc_coarse_seeded(wfc);
+    int skipped = wfc_coarse_skipped(wfc);
+
+    apply_coarse_seed(wfc, 0, 0);
+    CHECK(wfc_coarse_skipped(wfc) == skipped + 1);
+    CHECK(wfc_coarse_seeded(wfc) == seeded);
+    CHECK(cells_equal(wfc->grid, before, cells, wfc->pattern_count));
+    CHECK(wfc->undo.count == 0);
+    int still_saved = 0;
+    for(int i = 0; i < cells; i++) still_saved += wfc->undo.saved[i];
+    CHECK(still_saved == 0);
+
+    // With the real rules the same seed commits and narrows the grid
+    memcpy(wfc->adjacency, saved_adjacency, adjacency_size);
+    apply_coarse_seed(wfc, 0, 0);
+    CHECK(wfc_coarse_seeded(wfc) == seeded + 1);
+    CHECK(wfc_coarse_skipped(wfc) == skipped + 1);
+    CHECK(!cells_equal(wfc->grid, before, cells, wfc->pattern_count));
+    CHECK(wfc->undo.count == 0);
+
+    free(before);
+    free(saved_adjacency);
+    free(buffer);
+}
+
+// Same seed, same output
+static void test_deterministic(const unsigned char *rgba, int width, int height) {
+    size_t bytes = TEST_SIZE * TEST_SIZE * 4;
+    unsigned char *first = malloc(bytes);
+    unsigned char *second = malloc(bytes);
+
+    for(int h = 0; h < 2; h++) {
+        WFCStatus a = solve(rgba, width, height, h, 1234, first, false);
+        WFCStatus b = solve(rgba, width, height, h, 1234, second, false);
+        CHECK(a == b);
+        CHECK(memcmp(first, second, bytes) == 0);
+    }
+
+    free(first);
+    free(second);
+}
+
+// Solved outputs have no holes, in both modes
+static void test_solved_output(const unsigned char *rgba, int width, int height) {
+    unsigned char *output = malloc(TEST_SIZE * TEST_SIZE * 4);
+    for(int h = 0; h < 2; h++) {
+        CHECK(solve(rgba, width, height, h, 42, output, true) == WFC_DONE);
+    }
+    free(output);
+}
+
+int main(int argc, char *argv[]) {
+    const char *seed_file = argc > 1 ? argv[1] : DEFAULT_SEED;
+    int width, height;
+    unsigned char *rgba = load_png_rgba(seed_file, &width, &height);
+    if(rgba == NULL) {
+        printf("Failed to load seed: %s\n", seed_file);
+        return 1;
+    }
+
+    test_arena_size(rgba, width, height);
+    test_cancel_reset(rgba, width, height);
+    test_cancel_latency(rgba, width, height);
+    test_seed_rollback(rgba, width, height);
+    test_deterministic(rgba, width, height);
+    test_solved_output(rgba, width, height);
+
+    free(rgba);
+    if(failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All libwfc tests passed (%s)\n", seed_file);
+    return 0;
+}